@@ -34,6 +34,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "colib/narray.h"
 #include "smartptr.h"
@@ -42,295 +45,345 @@ namespace colib {
 
     namespace {
 
-        inline int hash_next(int size) {
-            int i = 1;
-            while(i<=size) i<<=1;
-            return i+1;
+        // Hash tables below use power-of-two capacities, so hash values
+        // need to be well mixed in all bits.
+
+        inline unsigned hash_mix(unsigned h) {
+            h ^= h >> 16;
+            h *= 0x85ebca6bU;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35U;
+            h ^= h >> 16;
+            return h;
         }
 
-        inline int hash_value(int key,int n) {
-            ASSERT(n>0);
-            return int(unsigned(98.209328340918084289029384908 * key
-                                + 0.2349082034802840982092834098)%n);
+        inline unsigned hash_value(int key) {
+            return hash_mix(unsigned(key));
         }
 
-        inline int hash_value(int key1,int key2,int n) {
-            ASSERT(n>0);
-            return int(unsigned(1793.02934802983402808942308402389908 * key1 +
-                                34.34983902935890238058909480840238 * key2
-                                + 0.8949173412390482890423908048) % n);
+        inline unsigned hash_value(int key1,int key2) {
+            return hash_mix(unsigned(key1) * 0x9e3779b1U + hash_mix(unsigned(key2)));
         }
 
-        inline int hash_value(const char *p,int n) {
-            double total = 0.0;
+        inline unsigned hash_value(const char *p) {
+            unsigned h = 2166136261U;
             while(*p) {
-                total = total * 1.29008352390840238 + (*p++) * 0.209384902384;
+                h ^= (unsigned char)*p++;
+                h *= 16777619U;
             }
-            return int(unsigned(total)%n);
+            return hash_mix(h);
         }
 
-    }
-    
+        enum { hash_group = 16, hash_ctrl_empty = 0x80 };
 
+        // Return a bit mask of the positions among the 16 control
+        // bytes starting at ctrl that are equal to c.
 
-    /// \brief A simple int-to-something hash class.
+        inline unsigned hash_match(const unsigned char *ctrl,unsigned char c) {
+#ifdef __SSE2__
+            __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(group,_mm_set1_epi8(c)));
+#else
+            unsigned mask = 0;
+            for(int i=0;i<hash_group;i++)
+                if(ctrl[i]==c) mask |= 1<<i;
+            return mask;
+#endif
+        }
+
+        inline int hash_first(unsigned mask) {
+            return __builtin_ctz(mask);
+        }
+    }
+
+    /// \brief Open addressing hash table used to implement inthash,
+    /// int2hash, and strhash.
     ///
-    /// This is not particularly high performance, but it should be good enough for most uses.
+    /// The capacity is a power of two.  Each slot has a control byte that
+    /// is either empty or holds 7 bits of the hash value; lookups compare
+    /// 16 control bytes at a time (with SSE2 if available) and only
+    /// compare keys whose control byte matches.  Slots are probed linearly
+    /// from the home position given by the remaining hash bits, so erasing
+    /// can shift subsequent entries back instead of leaving tombstones.
+    ///
+    /// K is the stored key type; Keys supplies the static functions
+    /// hash, equal, query (stored key to lookup key), assign and clear.
 
-    template <class T>
-    class inthash {
-    private:
-        enum { hash_empty = ~0 };
-
-        struct kvp {
-            int key;
-            T value;
-            kvp() { key = hash_empty; }
-        };
-        narray<kvp> data;
+    template <class K,class T,class Keys>
+    class flathash {
+    public:
+        typedef typename Keys::query_type Q;
+    protected:
+        // control bytes; the first hash_group-1 are mirrored at the end
+        narray<unsigned char> ctrl;
+        narray<K> keys_;
+        narray<T> values;
         int fill;
-        void maybe_grow() {
-            if(fill>data.length()/2)
-                grow(data.length()+1);
+
+        int capacity() {
+            return keys_.length();
+        }
+        void set_ctrl(int i,unsigned char c) {
+            ctrl[i] = c;
+            if(i<hash_group-1) ctrl[capacity()+i] = c;
+        }
+        void init(int n) {
+            int c = hash_group;
+            while(c<n) c <<= 1;
+            ctrl.resize(c+hash_group-1);
+            ctrl.fill((unsigned char)hash_ctrl_empty);
+            keys_.dealloc();
+            keys_.resize(c);
+            values.dealloc();
+            values.resize(c);
+            fill = 0;
+        }
+
+        // return the first empty slot on the probe sequence for h
+        int free_slot(unsigned h) {
+            int mask = capacity()-1;
+            int pos = (h>>7) & mask;
+            for(;;) {
+                unsigned m = hash_match(&ctrl[pos],hash_ctrl_empty);
+                if(m) return (pos+hash_first(m)) & mask;
+                pos = (pos+hash_group) & mask;
+            }
+        }
+
+        // insert a new entry into a slot without checking for duplicates
+        int place(unsigned h) {
+            int slot = free_slot(h);
+            set_ctrl(slot,h & 0x7f);
+            fill++;
+            return slot;
+        }
+
+        void rehash(int n) {
+            narray<unsigned char> octrl;
+            narray<K> okeys;
+            narray<T> ovalues;
+            octrl.move(ctrl);
+            okeys.move(keys_);
+            ovalues.move(values);
+            init(n);
+            for(int i=0;i<okeys.length();i++) {
+                if(octrl[i]==hash_ctrl_empty) continue;
+                int slot = place(Keys::hash(Keys::query(okeys[i])));
+                na_transfer(keys_[slot],okeys[i]);
+                na_transfer(values[slot],ovalues[i]);
+            }
+        }
+
+        int lookup(Q key) {
+            unsigned h = Keys::hash(key);
+            unsigned char h2 = h & 0x7f;
+            int mask = capacity()-1;
+            int pos = (h>>7) & mask;
+            for(;;) {
+                const unsigned char *group = &ctrl[pos];
+                unsigned m = hash_match(group,h2);
+                while(m) {
+                    int slot = (pos+hash_first(m)) & mask;
+                    if(Keys::equal(keys_[slot],key)) return slot;
+                    m &= m-1;
+                }
+                if(hash_match(group,hash_ctrl_empty)) return -1;
+                pos = (pos+hash_group) & mask;
+            }
+        }
+
+        T &insert(Q key) {
+            int slot = lookup(key);
+            if(slot>=0) return values[slot];
+            if(8*(fill+1)>7*capacity()) rehash(2*capacity());
+            slot = place(Keys::hash(key));
+            Keys::assign(keys_[slot],key);
+            return values[slot];
+        }
+
+        bool remove(Q key) {
+            int i = lookup(key);
+            if(i<0) return false;
+            int mask = capacity()-1;
+            Keys::clear(keys_[i]);
+            values[i] = T();
+            set_ctrl(i,hash_ctrl_empty);
+            fill--;
+            // shift back entries whose probe sequence passes through i
+            for(int j=(i+1)&mask;ctrl[j]!=hash_ctrl_empty;j=(j+1)&mask) {
+                int home = (Keys::hash(Keys::query(keys_[j]))>>7) & mask;
+                if(((j-home)&mask) < ((j-i)&mask)) continue;
+                set_ctrl(i,ctrl[j]);
+                na_transfer(keys_[i],keys_[j]);
+                na_transfer(values[i],values[j]);
+                values[j] = T();
+                set_ctrl(j,hash_ctrl_empty);
+                i = j;
+            }
+            return true;
+        }
+
+        T *search(Q key) {
+            int slot = lookup(key);
+            return slot<0 ? 0 : &values[slot];
         }
 
     public:
 
-        /// Allocate a hash table with a given initial size.
+        /// Allocate a hash table with room for a given number of entries.
 
-        inthash(int initial=3) {
-            data.resize(max(3,initial));
-            fill = 0;
+        flathash(int initial=3) {
+            init(initial+initial/7+1);
         }
 
         /// Make the hash table empty again and deallocate all the data it holds.
-        
+
         void dealloc() {
-            data.dealloc();
-            data.resize(3);
-            fill = 0;
+            init(0);
         }
 
         /// Grow the hash table by the given amount.
 
         void grow_by(int n) {
             ASSERT(n>=0);
-            inthash nhash(data.length()+n);
-            for(int i=0;i<data.length();i++) {
-                kvp &entry = data[i];
-                if(entry.key==hash_empty) continue;
-                nhash(entry.key) = entry.value;
-            }
-            move(data,nhash.data);
-            fill = nhash.fill;
+            rehash(capacity()+n);
+        }
+
+        /// Number of entries in the table.
+
+        int count() {
+            return fill;
+        }
+    };
+
+    struct inthash_keys {
+        typedef int query_type;
+        static unsigned hash(int key) { return hash_value(key); }
+        static bool equal(int stored,int key) { return stored==key; }
+        static int query(int stored) { return stored; }
+        static void assign(int &stored,int key) { stored = key; }
+        static void clear(int &stored) {}
+    };
+
+    /// \brief A simple int-to-something hash class.
+
+    template <class T>
+    class inthash : public flathash<int,T,inthash_keys> {
+        typedef flathash<int,T,inthash_keys> Base;
+    public:
+
+        /// Allocate a hash table with a given initial size.
+
+        inthash(int initial=3) : Base(initial) {
         }
 
         /// Return a reference to the location associated with the given key.
 
         T &operator()(int key) {
-            if(key==hash_empty) throw "key value reserved for hash table implementation";
-            int n = data.length();
-            int base = hash_value(key,n);
-            for(int i=0;i<n;i++) {
-                int index = (base+i)%n;
-                kvp &entry = data[index];
-                if(entry.key==key)
-                    return entry.value;
-                if(entry.key==hash_empty) {
-                    if(fill<data.length()/2) {
-                        fill++;
-                        entry.key = key;
-                        return entry.value;
-                    }
-                    grow_by(hash_next(data.length())-data.length());
-                    return operator()(key);
-                }
-            }
-            throw "internal error: no empty hash bucket found";
+            return this->insert(key);
         }
 
         /// Return a pointer to the location associated with the given key, or
         /// null if there is no such location.
 
         T *find(int key) {
-            if(key==hash_empty) throw "key value reserved for hash table implementation";
-            int n = data.length();
-            int base = hash_value(key,n);
-            for(int i=0;i<n;i++) {
-                int index = (base+i)%n;
-                kvp &entry = data[index];
-                if(entry.key==key)
-                    return &entry.value;
-                if(entry.key==hash_empty) {
-                    return 0;
-                }
-            }
+            return this->search(key);
         }
 
         T &at(int key) {
-            return this->operator()(key);
+            return this->insert(key);
+        }
+
+        /// Remove the entry for the key; returns false if there was none.
+
+        bool erase(int key) {
+            return this->remove(key);
         }
 
         /// Return a list of keys.
 
         void keys(narray<int> &result) {
             result.clear();
-            for(int i=0;i<data.length();i++) {
-                kvp &entry = data[i];
-                if(entry.key!=hash_empty) {
-                    result.push(entry.key);
-                }
-            }
+            for(int i=0;i<this->keys_.length();i++)
+                if(this->ctrl[i]!=hash_ctrl_empty)
+                    result.push(this->keys_[i]);
+        }
+    };
+
+    struct int2hash_key {
+        int key1,key2;
+    };
+
+    struct int2hash_keys {
+        typedef int2hash_key query_type;
+        static unsigned hash(int2hash_key key) { return hash_value(key.key1,key.key2); }
+        static bool equal(int2hash_key &stored,int2hash_key key) {
+            return stored.key1==key.key1 && stored.key2==key.key2;
         }
+        static int2hash_key query(int2hash_key &stored) { return stored; }
+        static void assign(int2hash_key &stored,int2hash_key key) { stored = key; }
+        static void clear(int2hash_key &stored) {}
     };
 
     /// \brief A simple pair-of-int-to-something hash class.
-    ///
-    /// This is not particularly high performance, but it should be good enough for most uses.
 
     template <class T>
-    class int2hash {
-    private:
-        enum { hash_empty = ~0 };
-        struct kvp {
-            int key1,key2;
-            T value;
-            kvp() { key1 = hash_empty; }
-        };
-        narray<kvp> data;
-        int fill;
-        void maybe_grow() {
-            if(fill>data.length()/2)
-                grow(data.length()+1);
+    class int2hash : public flathash<int2hash_key,T,int2hash_keys> {
+        typedef flathash<int2hash_key,T,int2hash_keys> Base;
+        static int2hash_key pair(int key1,int key2) {
+            int2hash_key key;
+            key.key1 = key1;
+            key.key2 = key2;
+            return key;
         }
-
     public:
 
         /// Allocate a hash table with a given initial size.
 
-        int2hash(int initial=3) {
-            data.dealloc();
-            data.resize(max(3,initial));
-            fill = 0;
-        }
-
-        /// Make the hash table empty again and deallocate all the data it holds.
-        
-        void dealloc() {
-            data.dealloc();
-            data.resize(3);
-            fill = 0;
-        }
-
-        /// Grow the hash table by the given amount.
-
-        void grow_by(int n) {
-            ASSERT(n>=0);
-            int2hash<T> nhash(data.length()+n);
-            for(int i=0;i<data.length();i++) {
-                kvp &entry = data[i];
-                if(entry.key1==hash_empty) continue;
-                nhash(entry.key1,entry.key2) = entry.value;
-            }
-            move(data,nhash.data);
-            fill = nhash.fill;
+        int2hash(int initial=3) : Base(initial) {
         }
 
         /// Return a reference to the location associated with the given key.
 
         T &operator()(int key1,int key2) {
-            if(key1==hash_empty) throw "key value reserved for hash table implementation";
-            int n = data.length();
-            int base = hash_value(key1,key2,n);
-            for(int i=0;i<n;i++) {
-                int index = (base+i)%n;
-                kvp &entry = data[index];
-                if(entry.key1==key1 && entry.key2==key2)
-                    return entry.value;
-                if(entry.key1==hash_empty) {
-                    if(fill<data.length()/2) {
-                        fill++;
-                        entry.key1 = key1;
-                        entry.key2 = key2;
-                        return entry.value;
-                    }
-                    grow_by(hash_next(data.length())-data.length());
-                    return operator()(key1,key2);
-                }
-            }
-            throw "internal error: no empty hash bucket found";
+            return this->insert(pair(key1,key2));
         }
 
         /// Return a pointer to the location associated with the keys, or null
         /// if there is no entry.
 
         T *find(int key1,int key2) {
-            if(key1==hash_empty) throw "key value reserved for hash table implementation";
-            int n = data.length();
-            int base = hash_value(key1,key2,n);
-            for(int i=0;i<n;i++) {
-                int index = (base+i)%n;
-                kvp &entry = data[index];
-                if(entry.key1==key1 && entry.key2==key2)
-                    return &entry.value;
-                if(entry.key1==hash_empty) {
-                    return 0;
-                }
-            }
-            throw "internal error: no empty hash bucket found";
+            return this->search(pair(key1,key2));
+        }
+
+        /// Remove the entry for the keys; returns false if there was none.
+
+        bool erase(int key1,int key2) {
+            return this->remove(pair(key1,key2));
         }
     };
 
-    /// A string-to-something hash class.
+    struct strhash_keys {
+        typedef const char *query_type;
+        static unsigned hash(const char *key) { return hash_value(key); }
+        static bool equal(autofree<char> &stored,const char *key) {
+            return !strcmp(stored.ptr(),key);
+        }
+        static const char *query(autofree<char> &stored) { return stored.ptr(); }
+        static void assign(autofree<char> &stored,const char *key) { stored = strdup(key); }
+        static void clear(autofree<char> &stored) { stored = (char*)0; }
+    };
 
     /// \brief A simple string-to-something hash class.
-    ///
-    /// This is not particularly high performance, but it should be good enough for most uses.
 
     template <class T>
-    class strhash {
-    private:
-        struct kvp {
-            autofree<char> key;
-            T value;
-        };
-        narray<kvp> data;
-        int fill;
-        void maybe_grow() {
-            if(fill>data.length()/2)
-                grow(data.length()+1);
-        }
-
+    class strhash : public flathash<autofree<char>,T,strhash_keys> {
+        typedef flathash<autofree<char>,T,strhash_keys> Base;
     public:
 
         /// Allocate a hash table with a given initial size.
 
-        strhash(int initial=3) {
-            data.dealloc();
-            data.resize(max(3,initial));
-            fill = 0;
-        }
-
-        /// Make the hash table empty again and deallocate all the data it holds.
-        
-        void dealloc() {
-            data.dealloc();
-            data.resize(3);
-            fill = 0;
-        }
-
-        /// Grow the hash table by the given amount.
-
-        void grow_by(int n) {
-            ASSERT(n>=0);
-            strhash nhash(data.length()+n);
-            for(int i=0;i<data.length();i++) {
-                kvp &entry = data[i];
-                if(entry.key.ptr()==0) continue;
-                nhash(entry.key.ptr()) = entry.value;
-            }
-            move(data,nhash.data);
-            fill = nhash.fill;
+        strhash(int initial=3) : Base(initial) {
         }
 
         /// Return a pointer to the location of the value, or null if
@@ -338,41 +391,21 @@ namespace colib {
 
         T *find(const char *key) {
             if(key==0) throw "key value reserved for hash table implementation";
-            int n = data.length();
-            int base = hash_value(key,n);
-            for(int i=0;i<n;i++) {
-                int index = (base+i)%n;
-                kvp &entry = data[index];
-                if(entry.key.ptr() && !strcmp(entry.key.ptr(),key))
-                    return &entry.value;
-                if(!entry.key) {
-                    return 0;
-                }
-            }
-            throw "internal error: no empty hash bucket found";
+            return this->search(key);
         }
+
         /// Return a reference to the location associated with the given key.
 
         T &operator()(const char *key) {
             if(key==0) throw "key value reserved for hash table implementation";
-            int n = data.length();
-            int base = hash_value(key,n);
-            for(int i=0;i<n;i++) {
-                int index = (base+i)%n;
-                kvp &entry = data[index];
-                if(entry.key.ptr() && !strcmp(entry.key.ptr(),key))
-                    return entry.value;
-                if(!entry.key) {
-                    if(fill<data.length()/2) {
-                        fill++;
-                        entry.key = strdup(key);
-                        return entry.value;
-                    }
-                    grow_by(hash_next(data.length())-data.length());
-                    return operator()(key);
-                }
-            }
-            throw "internal error: no empty hash bucket found";
+            return this->insert(key);
+        }
+
+        /// Remove the entry for the key; returns false if there was none.
+
+        bool erase(const char *key) {
+            if(key==0) throw "key value reserved for hash table implementation";
+            return this->remove(key);
         }
 
         /// Return a list of keys.
@@ -380,12 +413,9 @@ namespace colib {
 
         void keys(narray<const char*> &result) {
             result.clear();
-            for(int i=0;i<data.length();i++) {
-                kvp &entry = data[i];
-                if(entry.key.ptr()!=0) {
-                    result.push() = entry.key.ptr();
-                }
-            }
+            for(int i=0;i<this->keys_.length();i++)
+                if(this->ctrl[i]!=hash_ctrl_empty)
+                    result.push() = this->keys_[i].ptr();
         }
     };
 }
@@ -28,7 +28,11 @@
 #define narray_io_h_
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <zlib.h>
 //#include "ocropus.h"
 
 // GNU C++ incorrectly warns about type punning and aliasing below;
@@ -107,6 +111,333 @@ namespace narray_io {
         CHECK(fwrite(&value,sizeof value,1,stream)==1);
     }
 
+    // Versioned container format.  Each array is stored as a fixed-size
+    // header followed by the data in a single block, so reading and
+    // writing an array takes one large I/O call.  The header records the
+    // byte order of the writer (arrays are byte swapped on reading if
+    // necessary), the element size, and a CRC-32 of the uncompressed
+    // data.  The data can optionally be zlib compressed in blocks of
+    // container_block bytes.  Ragged arrays are stored with an offset
+    // table so that individual elements can be read without reading the
+    // whole array (see narray_load_element).  narray_read recognizes
+    // this format, so files written with narray_save can be loaded by
+    // existing code.
+
+    enum {
+        container_raw = 0,
+        container_zlib = 1
+    };
+
+    enum {
+        container_version = 1,
+        container_block = 1<<20
+    };
+
+    struct container_header {
+        char magic[4];
+        unsigned char version;
+        unsigned char order;
+        unsigned char elsize;   // zero for ragged arrays
+        unsigned char compression;
+        int32_t dims[4];
+        uint32_t checksum;
+        uint32_t nblocks;
+        int64_t nbytes;         // bytes following the header
+    };
+
+    inline bool is_container_magic(const void *magic) {
+        return !memcmp(magic,"NAR2",4);
+    }
+
+    inline unsigned char native_order() {
+        unsigned short probe = 1;
+        return *(unsigned char *)&probe ? 1 : 2;
+    }
+
+    inline void byteswap(void *data,int elsize,long n) {
+        unsigned char *p = (unsigned char *)data;
+        if(elsize<=1) return;
+        for(long i=0;i<n;i++,p+=elsize) {
+            for(int j=0,k=elsize-1;j<k;j++,k--) {
+                unsigned char t = p[j];
+                p[j] = p[k];
+                p[k] = t;
+            }
+        }
+    }
+
+    inline void container_init(container_header &header,int elsize,int compression) {
+        memset(&header,0,sizeof header);
+        memcpy(header.magic,"NAR2",4);
+        header.version = container_version;
+        header.order = native_order();
+        header.elsize = elsize;
+        header.compression = compression;
+    }
+
+    inline void container_fix_order(container_header &header) {
+        CHECK(header.version==container_version);
+        CHECK(header.order==1 || header.order==2);
+        if(header.order==native_order()) return;
+        byteswap(header.dims,sizeof header.dims[0],4);
+        byteswap(&header.checksum,sizeof header.checksum,1);
+        byteswap(&header.nblocks,sizeof header.nblocks,1);
+        byteswap(&header.nbytes,sizeof header.nbytes,1);
+    }
+
+    // read the rest of the header after the magic number has been read
+
+    inline void container_read_header(FILE *stream,container_header &header) {
+        int n = sizeof header - sizeof header.magic;
+        CHECK(fread(&header.version,1,n,stream)==unsigned(n));
+        container_fix_order(header);
+    }
+
+    inline uint32_t container_checksum(const void *data,long nbytes) {
+        uLong crc = crc32(0L,Z_NULL,0);
+        const Bytef *p = (const Bytef *)data;
+        while(nbytes>0) {
+            uInt n = nbytes>(1<<30) ? (1<<30) : uInt(nbytes);
+            crc = crc32(crc,p,n);
+            p += n;
+            nbytes -= n;
+        }
+        return uint32_t(crc);
+    }
+
+    // Encode raw data as a sequence of compressed blocks, preceded by a
+    // table of the compressed block sizes.
+
+    inline void container_compress(narray<unsigned char> &out,uint32_t &nblocks,
+                                   const unsigned char *data,long nbytes,int level) {
+        nblocks = uint32_t((nbytes+container_block-1)/container_block);
+        long bound = nblocks*sizeof (uint32_t);
+        for(uint32_t b=0;b<nblocks;b++) {
+            long n = min(long(container_block),nbytes-long(b)*container_block);
+            bound += compressBound(n);
+        }
+        out.resize(bound);
+        uint32_t *sizes = (uint32_t *)&out.at1d(0);
+        long offset = nblocks*sizeof (uint32_t);
+        for(uint32_t b=0;b<nblocks;b++) {
+            long n = min(long(container_block),nbytes-long(b)*container_block);
+            uLongf csize = bound - offset;
+            if(compress2(&out.at1d(offset),&csize,data+long(b)*container_block,n,level)!=Z_OK)
+                throw "narray_save: zlib compression failed";
+            sizes[b] = csize;
+            offset += csize;
+        }
+        out.truncate(offset);
+    }
+
+    inline void container_uncompress(unsigned char *data,long nbytes,
+                                     const unsigned char *in,long nin,uint32_t nblocks) {
+        CHECK(nblocks==uint32_t((nbytes+container_block-1)/container_block));
+        CHECK(long(nblocks*sizeof (uint32_t))<=nin);
+        const unsigned char *p = in + nblocks*sizeof (uint32_t);
+        for(uint32_t b=0;b<nblocks;b++) {
+            uint32_t csize;
+            memcpy(&csize,in+b*sizeof csize,sizeof csize);
+            CHECK(p+csize<=in+nin);
+            long n = min(long(container_block),nbytes-long(b)*container_block);
+            uLongf size = n;
+            if(uncompress(data+long(b)*container_block,&size,p,csize)!=Z_OK || long(size)!=n)
+                throw "narray_load: corrupted compressed data";
+            p += csize;
+        }
+    }
+
+    // Encode an array, appending the result to a byte buffer.
+
+    template <class T>
+    inline void container_encode(narray<unsigned char> &out,narray<T> &data,int compression,int level) {
+        if(0) data[0]+0;
+        container_header header;
+        container_init(header,sizeof (T),compression);
+        for(int i=0;i<4;i++) header.dims[i] = data.dims[i];
+        long nbytes = long(data.length1d())*sizeof (T);
+        const unsigned char *raw = nbytes>0 ? (const unsigned char *)&data.at1d(0) : 0;
+        header.checksum = container_checksum(raw,nbytes);
+        narray<unsigned char> packed;
+        if(compression==container_zlib) {
+            container_compress(packed,header.nblocks,raw,nbytes,level);
+            raw = packed.length()>0 ? &packed.at1d(0) : 0;
+            nbytes = packed.length();
+        } else {
+            CHECK_ARG(compression==container_raw);
+        }
+        header.nbytes = nbytes;
+        long start = out.length();
+        out.grow_to(start+sizeof header+nbytes);
+        memcpy(&out.at1d(start),&header,sizeof header);
+        if(nbytes>0) memcpy(&out.at1d(start+sizeof header),raw,nbytes);
+    }
+
+    // Decode the array payload following a header.
+
+    template <class T>
+    inline void container_decode(narray<T> &data,container_header &header,
+                                 const unsigned char *payload) {
+        if(0) data[0]+0;
+        CHECK(header.elsize==sizeof (T));
+        int32_t *dims = header.dims;
+        data.resize(dims[0],dims[1],dims[2],dims[3]);
+        long nbytes = long(data.length1d())*sizeof (T);
+        unsigned char *raw = nbytes>0 ? (unsigned char *)&data.at1d(0) : 0;
+        if(header.compression==container_zlib) {
+            container_uncompress(raw,nbytes,payload,header.nbytes,header.nblocks);
+        } else {
+            CHECK(header.compression==container_raw);
+            CHECK(header.nbytes==nbytes);
+            if(raw!=payload && nbytes>0) memcpy(raw,payload,nbytes);
+        }
+        if(container_checksum(raw,nbytes)!=header.checksum)
+            throw "narray_load: checksum error";
+        if(header.order!=native_order())
+            byteswap(raw,sizeof (T),data.length1d());
+    }
+
+    // Read the body of a container after its magic number has been read.
+
+    template <class T>
+    inline void container_read(FILE *stream,narray<T> &data) {
+        container_header header;
+        container_read_header(stream,header);
+        CHECK(header.elsize==sizeof (T));
+        if(header.compression==container_raw) {
+            // read straight into the destination array
+            int32_t *dims = header.dims;
+            data.resize(dims[0],dims[1],dims[2],dims[3]);
+            long nbytes = long(data.length1d())*sizeof (T);
+            CHECK(header.nbytes==nbytes);
+            unsigned char *raw = nbytes>0 ? (unsigned char *)&data.at1d(0) : 0;
+            if(nbytes>0) CHECK(long(fread(raw,1,nbytes,stream))==nbytes);
+            container_decode(data,header,raw);
+        } else {
+            narray<unsigned char> payload(header.nbytes);
+            if(header.nbytes>0)
+                CHECK(long(fread(&payload.at1d(0),1,header.nbytes,stream))==header.nbytes);
+            container_decode(data,header,payload.length()>0?&payload.at1d(0):0);
+        }
+    }
+
+    template <class T>
+    inline void container_read(FILE *stream,narray< narray<T> > &data) {
+        container_header header;
+        container_read_header(stream,header);
+        CHECK(header.elsize==0);
+        int32_t *dims = header.dims;
+        data.resize(dims[0],dims[1],dims[2],dims[3]);
+        int n = data.length1d();
+        narray<unsigned char> payload(header.nbytes);
+        if(header.nbytes>0)
+            CHECK(long(fread(&payload.at1d(0),1,header.nbytes,stream))==header.nbytes);
+        if(container_checksum(payload.length()>0?&payload.at1d(0):0,payload.length())!=header.checksum)
+            throw "narray_load: checksum error";
+        long table = (n+1)*sizeof (int64_t);
+        CHECK(header.nbytes>=table);
+        for(int i=0;i<n;i++) {
+            int64_t offset;
+            memcpy(&offset,&payload.at1d(i*sizeof offset),sizeof offset);
+            if(header.order!=native_order()) byteswap(&offset,sizeof offset,1);
+            CHECK(offset>=table && offset+long(sizeof (container_header))<=header.nbytes);
+            container_header element;
+            memcpy(&element,&payload.at1d(offset),sizeof element);
+            CHECK(is_container_magic(element.magic));
+            container_fix_order(element);
+            CHECK(offset+long(sizeof element)+element.nbytes<=header.nbytes);
+            container_decode(data.at1d(i),element,&payload.at1d(offset+sizeof element));
+        }
+    }
+
+    /// Save an array in the container format (optionally compressed).
+
+    template <class T>
+    inline void narray_save(FILE *stream,narray<T> &data,
+                            int compression=container_raw,int level=6) {
+        if(0) data[0]+0;
+        if(compression==container_raw) {
+            // write the header and then the array data in place
+            container_header header;
+            container_init(header,sizeof (T),compression);
+            for(int i=0;i<4;i++) header.dims[i] = data.dims[i];
+            long nbytes = long(data.length1d())*sizeof (T);
+            const void *raw = nbytes>0 ? &data.at1d(0) : 0;
+            header.checksum = container_checksum(raw,nbytes);
+            header.nbytes = nbytes;
+            CHECK(fwrite(&header,sizeof header,1,stream)==1);
+            if(nbytes>0) CHECK(long(fwrite(raw,1,nbytes,stream))==nbytes);
+        } else {
+            narray<unsigned char> buffer;
+            container_encode(buffer,data,compression,level);
+            CHECK(long(fwrite(&buffer.at1d(0),1,buffer.length(),stream))==buffer.length());
+        }
+    }
+
+    /// Save a ragged array in the container format; the elements are
+    /// preceded by a table of their offsets.
+
+    template <class T>
+    inline void narray_save(FILE *stream,narray< narray<T> > &data,
+                            int compression=container_raw,int level=6) {
+        int n = data.length1d();
+        narray<unsigned char> payload;
+        payload.resize((n+1)*sizeof (int64_t));
+        for(int i=0;i<n;i++) {
+            int64_t offset = payload.length();
+            memcpy(&payload.at1d(i*sizeof offset),&offset,sizeof offset);
+            container_encode(payload,data.at1d(i),compression,level);
+        }
+        int64_t end = payload.length();
+        memcpy(&payload.at1d(n*sizeof end),&end,sizeof end);
+        container_header header;
+        container_init(header,0,compression);
+        for(int i=0;i<4;i++) header.dims[i] = data.dims[i];
+        header.checksum = container_checksum(&payload.at1d(0),payload.length());
+        header.nbytes = payload.length();
+        CHECK(fwrite(&header,sizeof header,1,stream)==1);
+        CHECK(long(fwrite(&payload.at1d(0),1,payload.length(),stream))==payload.length());
+    }
+
+    /// Load an array saved with narray_save.
+
+    template <class T>
+    inline void narray_load(FILE *stream,narray<T> &data) {
+        char magic[4];
+        CHECK(fread(magic,1,4,stream)==4);
+        if(!is_container_magic(magic))
+            throw "narray_load: not an narray container";
+        container_read(stream,data);
+    }
+
+    /// Load element i of a ragged array saved with narray_save without
+    /// reading the other elements.  The stream must be seekable and positioned
+    /// at the start of the ragged array; it is left positioned after it.
+
+    template <class T>
+    inline void narray_load_element(FILE *stream,narray<T> &data,int i) {
+        long start = ftell(stream);
+        CHECK(start>=0);
+        container_header header;
+        CHECK(fread(header.magic,1,4,stream)==4);
+        if(!is_container_magic(header.magic))
+            throw "narray_load_element: not an narray container";
+        container_read_header(stream,header);
+        CHECK(header.elsize==0);
+        long n = long(header.dims[0])*(header.dims[1]?header.dims[1]:1)*
+            (header.dims[2]?header.dims[2]:1)*(header.dims[3]?header.dims[3]:1);
+        if(header.dims[0]==0) n = 0;
+        CHECK_ARG(i>=0 && i<n);
+        long base = start + sizeof header;
+        int64_t offset;
+        CHECK(fseek(stream,base+i*sizeof offset,SEEK_SET)==0);
+        CHECK(fread(&offset,sizeof offset,1,stream)==1);
+        if(header.order!=native_order()) byteswap(&offset,sizeof offset,1);
+        CHECK(fseek(stream,base+offset,SEEK_SET)==0);
+        narray_load(stream,data);
+        CHECK(fseek(stream,base+header.nbytes,SEEK_SET)==0);
+    }
+
     // array of scalar reading
 
     template <class T>
@@ -115,6 +446,10 @@ namespace narray_io {
         unsigned magic;
         CHECK(sizeof(magic)==4);
         CHECK(fread(&magic,sizeof magic,1,stream)==1);
+        if(is_container_magic(&magic)) {
+            container_read(stream,data);
+            return;
+        }
         CHECK(magic==magic_number<T>());
         int dims[4];
         CHECK(fread(dims,sizeof dims[0],4,stream)==4);
@@ -147,6 +482,10 @@ namespace narray_io {
         unsigned magic;
         CHECK(sizeof(magic)==4);
         CHECK(fread(&magic,sizeof magic,1,stream)==1);
+        if(is_container_magic(&magic)) {
+            container_read(stream,data);
+            return;
+        }
         CHECK(magic==293843);
         int dims[4];
         CHECK(fread(dims,sizeof dims[0],4,stream)==4);
@@ -167,6 +506,187 @@ namespace narray_io {
             narray_write(stream,data[i]);
     }
 
+    // Aligned array format.  This is like the format written by
+    // narray_write, but the header records its own size and is padded
+    // so that the array data starts at a multiple of narray_alignment
+    // in the file.  Such arrays can be memory mapped with MappedArray
+    // instead of being read.
+
+    enum { narray_alignment = 64 };
+
+    template <class T>
+    inline unsigned aligned_magic_number() {
+        return 0x0abf0000 + sizeof (T);
+    }
+
+    struct aligned_header {
+        unsigned magic;
+        int header_size;
+        int dims[4];
+    };
+
+    template <class T>
+    inline void narray_write_aligned(FILE *stream,narray<T> &data) {
+        if(0) data[0]+0;
+        long pos = ftell(stream);
+        if(pos<0) pos = 0;
+        long start = pos + sizeof (aligned_header);
+        int pad = int((narray_alignment - start%narray_alignment) % narray_alignment);
+        aligned_header header;
+        header.magic = aligned_magic_number<T>();
+        header.header_size = sizeof header + pad;
+        for(int i=0;i<4;i++) header.dims[i] = data.dims[i];
+        CHECK(fwrite(&header,sizeof header,1,stream)==1);
+        char zeros[narray_alignment];
+        memset(zeros,0,sizeof zeros);
+        if(pad>0) CHECK(fwrite(zeros,1,pad,stream)==unsigned(pad));
+        if(data.length1d()>0) {
+            CHECK((int)fwrite(&data.at1d(0),sizeof data.at1d(0),
+                              data.length1d(),stream)==data.length1d());
+        }
+    }
+
+    template <class T>
+    inline void narray_read_aligned(FILE *stream,narray<T> &data) {
+        if(0) data[0]+0;
+        aligned_header header;
+        CHECK(fread(&header,sizeof header,1,stream)==1);
+        CHECK(header.magic==aligned_magic_number<T>());
+        int pad = header.header_size - int(sizeof header);
+        CHECK(pad>=0 && pad<narray_alignment);
+        char skip[narray_alignment];
+        if(pad>0) CHECK(fread(skip,1,pad,stream)==unsigned(pad));
+        int *dims = header.dims;
+        data.resize(dims[0],dims[1],dims[2],dims[3]);
+        if(data.length1d()>0) {
+            CHECK((int)fread(&data.at1d(0),sizeof data.at1d(0),
+                             data.length1d(),stream)==data.length1d());
+        }
+    }
+
+    /// \brief Read-only, memory mapped array in the aligned format.
+    ///
+    /// Opening the file only reads the header; the pages holding the
+    /// array data are loaded lazily by the OS when they are first
+    /// touched and are shared between all processes mapping the same file.
+    /// The array is available as an ordinary narray through ref(), so
+    /// it can be passed to existing code, but it must not be modified
+    /// or resized.  Several arrays written in sequence with
+    /// narray_write_aligned can be mapped by passing next_offset() of
+    /// one array as the offset of the next.
+
+    template <class T>
+    class MappedArray {
+    private:
+        narray<T> array;
+        void *base;
+        size_t mapped;
+        T *mapped_data;
+        long next;
+        MappedArray(const MappedArray<T> &);
+        void operator=(const MappedArray<T> &);
+
+    public:
+        MappedArray() {
+            base = 0;
+            mapped = 0;
+            mapped_data = 0;
+            next = 0;
+        }
+        MappedArray(const char *file,long offset=0) {
+            base = 0;
+            mapped = 0;
+            mapped_data = 0;
+            next = 0;
+            open(file,offset);
+        }
+        ~MappedArray() {
+            close();
+        }
+
+        /// Map the array whose header starts at the given file offset.
+
+        void open(const char *file,long offset=0) {
+            close();
+            int fd = ::open(file,O_RDONLY);
+            if(fd<0) throwf("%s: cannot open file for reading",file);
+            aligned_header header;
+            struct stat st;
+            if(fstat(fd,&st)<0 ||
+               pread(fd,&header,sizeof header,offset)!=(ssize_t)sizeof header) {
+                ::close(fd);
+                throwf("%s: cannot read array header",file);
+            }
+            if(header.magic!=aligned_magic_number<T>()) {
+                ::close(fd);
+                throwf("%s: not an aligned array of the requested type",file);
+            }
+            int *dims = header.dims;
+            long n = long(dims[0])*(dims[1]?dims[1]:1)*(dims[2]?dims[2]:1)*(dims[3]?dims[3]:1);
+            long data_offset = offset + header.header_size;
+            long nbytes = n * long(sizeof (T));
+            if(dims[0]==0) n = nbytes = 0;
+            if(data_offset+nbytes>st.st_size) {
+                ::close(fd);
+                throwf("%s: file too short for array",file);
+            }
+            if(nbytes>0) {
+                long page = sysconf(_SC_PAGESIZE);
+                long start = data_offset - data_offset%page;
+                mapped = size_t(data_offset - start + nbytes);
+                base = mmap(0,mapped,PROT_READ,MAP_SHARED,fd,start);
+                if(base==MAP_FAILED) {
+                    base = 0;
+                    mapped = 0;
+                    ::close(fd);
+                    throwf("%s: mmap failed",file);
+                }
+                mapped_data = (T*)((char*)base + (data_offset - start));
+            }
+            ::close(fd);
+            array.data = mapped_data;
+            array.allocated = n;
+            array.total = n;
+            for(int i=0;i<4;i++) array.dims[i] = dims[i];
+            array.dims[4] = 0;
+            next = data_offset + nbytes;
+        }
+
+        /// Unmap the array.
+
+        void close() {
+            if(array.data==mapped_data) array.data = 0;
+            array.dealloc();
+            if(base) munmap(base,mapped);
+            base = 0;
+            mapped = 0;
+            mapped_data = 0;
+            next = 0;
+        }
+
+        /// Ask the OS to start paging in the whole array now.
+
+        void prefetch() {
+            if(base) madvise(base,mapped,MADV_WILLNEED);
+        }
+
+        /// The file offset just past the end of this array.
+
+        long next_offset() {
+            return next;
+        }
+
+        narray<T> &ref() {
+            return array;
+        }
+        narray<T> &operator*() {
+            return array;
+        }
+        narray<T> *operator->() {
+            return &array;
+        }
+    };
+
     inline unsigned read32(FILE *stream) {
         unsigned result = 0;
         result = (fgetc(stream)&0xff);
@@ -55,6 +55,37 @@
 #include <stdio.h>
 #define NARRAY_NOTICE(x) fprintf(stderr,x "\n");
 
+// Define NARRAY_STATS to count allocations, element copies and moves
+// made by narrays; this is useful for finding redundant temporaries
+// in inner loops.  The counters are global and not thread safe.
+
+#ifdef NARRAY_STATS
+namespace colib {
+    struct narray_stats {
+        long allocs;
+        long alloc_bytes;
+        long copies;
+        long moves;
+    };
+    inline narray_stats &narray_counters() {
+        static narray_stats stats;
+        return stats;
+    }
+    inline void narray_reset_counters() {
+        narray_stats &stats = narray_counters();
+        stats.allocs = stats.alloc_bytes = stats.copies = stats.moves = 0;
+    }
+    inline void narray_print_counters(FILE *stream=stderr) {
+        narray_stats &stats = narray_counters();
+        fprintf(stream,"narray: %ld allocs (%ld bytes) %ld copies %ld moves\n",
+                stats.allocs,stats.alloc_bytes,stats.copies,stats.moves);
+    }
+}
+#define NARRAY_COUNT(field,n) (colib::narray_counters().field += (n))
+#else
+#define NARRAY_COUNT(field,n)
+#endif
+
 namespace colib {
     // na_transfer is used to transfer objects from an old container
     // to a new one.  You can overload na_transfer if you have other
@@ -162,10 +193,10 @@ namespace colib {
         }
 
         void operator=(narray<T> &&other) {
-            move(other);
+            if(this!=&other) move(other);
         }
         narray<T> &&rvalue() {
-            return *this;
+            return static_cast<narray<T>&&>(*this);
         }
 #endif
 
@@ -202,6 +233,8 @@ namespace colib {
             total = total_(d0,d1,d2,d3);
             data = new T[total];
             allocated = total;
+            NARRAY_COUNT(allocs,1);
+            NARRAY_COUNT(alloc_bytes,total*sizeof (T));
             dims[0] = d0; dims[1] = d1; dims[2] = d2; dims[3] = d3; dims[4] = 0;
         }
 
@@ -458,6 +491,8 @@ namespace colib {
             if(nallocated<=allocated) return;
             nallocated = roundup_(nallocated);
             T *ndata = new T[nallocated];
+            NARRAY_COUNT(allocs,1);
+            NARRAY_COUNT(alloc_bytes,nallocated*sizeof (T));
             for(index_t i=0;i<total;i++) {
                 // ndata[i] = data[i];
                 na_transfer(ndata[i],data[i]);
@@ -568,6 +603,7 @@ namespace colib {
             dest.allocated = src.allocated;
             src.data = 0;
             src.dealloc();
+            NARRAY_COUNT(moves,1);
         }
 
         /// Swap the contents of the two arrays.
@@ -589,6 +625,7 @@ namespace colib {
             dest.resize(src.dim(0),src.dim(1),src.dim(2),src.dim(3));
             index_t n = dest.length1d();
             for(index_t i=0;i<n;i++) dest.unsafe_at1d(i) = (T)src.unsafe_at1d(i);
+            NARRAY_COUNT(copies,1);
         }
 
         /// Copy the elements of the source array into the destination array,
@@ -48,6 +48,15 @@ namespace colib {
         objlist(int n):data(n) {
         }
 
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+        objlist(objlist<T> &&other) {
+            data.move(other.data);
+        }
+        void operator=(objlist<T> &&other) {
+            data.move(other.data);
+        }
+#endif
+
         int length() {
             return data.length();
         }
@@ -131,6 +140,17 @@ namespace colib {
         typedef autodel<T> Element;
         narray<Element> data;
 
+        ptrlist() {
+        }
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+        ptrlist(ptrlist<T> &&other) {
+            data.move(other.data);
+        }
+        void operator=(ptrlist<T> &&other) {
+            data.move(other.data);
+        }
+#endif
+
         int length() {
             return data.length();
         }
@@ -189,6 +209,17 @@ namespace colib {
             data[i].dealloc();
         }
     };
+
+    // Define na_transfer to allow use in narray.
+
+    template <class T>
+    inline void na_transfer(objlist<T> &dst,objlist<T> &src) {
+        dst.data.move(src.data);
+    }
+    template <class T>
+    inline void na_transfer(ptrlist<T> &dst,ptrlist<T> &src) {
+        dst.data.move(src.data);
+    }
 }
 
 #endif
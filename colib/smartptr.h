@@ -194,6 +194,18 @@ namespace colib {
             pointer = new_pointer;
         }
 
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+        /// Move construction and assignment from temporaries, so that
+        /// smart pointers can be returned by value.
+
+        autodel(autodel<T> &&other) {
+            pointer = other.move();
+        }
+        void operator=(autodel<T> &&other) {
+            operator=(other);
+        }
+#endif
+
         /// Take ownership away from this smart pointer and set the smart pointer to null.
 
         T *move() {
@@ -287,9 +299,23 @@ namespace colib {
         /// and set the other smart pointer to null.
 
         void operator=(autofree<T> &other) {
-            if(pointer) delete pointer;
+            T *new_pointer = other.move();
+            if(pointer && pointer != new_pointer)
+                free(pointer);
+            pointer = new_pointer;
+        }
+
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+        /// Move construction and assignment from temporaries, so that
+        /// smart pointers can be returned by value.
+
+        autofree(autofree<T> &&other) {
             pointer = other.move();
         }
+        void operator=(autofree<T> &&other) {
+            operator=(other);
+        }
+#endif
 
         /// Take ownership away from this smart pointer and set the smart pointer to null.
 
@@ -386,6 +412,18 @@ namespace colib {
             pointer = new_pointer;
         }
 
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+        /// Move construction and assignment from temporaries, so that
+        /// smart pointers can be returned by value.
+
+        autoref(autoref<T> &&other) {
+            pointer = other.move();
+        }
+        void operator=(autoref<T> &&other) {
+            operator=(other);
+        }
+#endif
+
         /// Take ownership away from this smart pointer and set the smart pointer to null.
 
         T *move() {
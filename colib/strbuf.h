@@ -45,6 +45,22 @@ namespace colib {
             buf = 0;
             ensure(n);
         }
+        strbuf(const strbuf &other) {
+            buf = 0;
+            if(other.buf) *this = other.buf;
+        }
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+        strbuf(strbuf &&other) {
+            buf = other.buf;
+            other.buf = 0;
+        }
+        void operator=(strbuf &&other) {
+            if(this==&other) return;
+            dealloc();
+            buf = other.buf;
+            other.buf = 0;
+        }
+#endif
         ~strbuf() {
             dealloc();
         }
@@ -81,6 +97,8 @@ namespace colib {
             strcpy(buf,src);
         }
         void operator=(const strbuf &other) {
+            if(this==&other) return;
+            if(!other.buf) { dealloc(); return; }
             *this = other.buf;
         }
         void operator+=(char other) {
@@ -138,6 +156,22 @@ namespace colib {
         utf8buf() {
             buf = 0;
         }
+        utf8buf(const utf8buf &other) {
+            buf = 0;
+            if(other.buf) *this = other.buf;
+        }
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+        utf8buf(utf8buf &&other) {
+            buf = other.buf;
+            other.buf = 0;
+        }
+        void operator=(utf8buf &&other) {
+            if(this==&other) return;
+            dealloc();
+            buf = other.buf;
+            other.buf = 0;
+        }
+#endif
         ~utf8buf() {
             dealloc();
         }
@@ -153,7 +187,9 @@ namespace colib {
             ensure(strlen(src));
             strcpy(buf,src);
         }
-        void operator=(utf8buf &other) {
+        void operator=(const utf8buf &other) {
+            if(this==&other) return;
+            if(!other.buf) { dealloc(); return; }
             *this = other.buf;
         }
         operator char*() {
@@ -166,13 +202,19 @@ namespace colib {
         }
     };
 
-#if 0
-    // FIXME add the necessary methods to make this work
-    template <class T>
+    // Define na_transfer to allow use in narray; this hands over
+    // the buffer instead of copying the string.
+
     inline void na_transfer(strbuf &dst,strbuf &src) {
-        dst.setPointer(src.take());
+        dst.dealloc();
+        dst.buf = src.buf;
+        src.buf = 0;
+    }
+    inline void na_transfer(utf8buf &dst,utf8buf &src) {
+        dst.dealloc();
+        dst.buf = src.buf;
+        src.buf = 0;
     }
-#endif
 }
 
 #endif /* strbuf_h__ */
@@ -0,0 +1,132 @@
+#include "colib.h"
+#include "narray-binio.h"
+
+// Copyright 2006 Deutsches Forschungszentrum fuer Kuenstliche Intelligenz
+// or its licensors, as applicable.
+//
+// You may not use this file except under the terms of the accompanying license.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You may
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Project: iulib -- image understanding library
+// File: test-narray-binio.cc
+// Purpose: test cases for binary array I/O
+// Responsible: tmb
+// Reviewer:
+// Primary Repository:
+// Web Sites: www.iupr.org, www.dfki.de
+
+
+using namespace colib;
+using namespace narray_io;
+
+int main(int argc,char **argv) {
+    const char *file = "_test_binio_";
+
+    floatarray a(37,11);
+    for(int i=0;i<a.length1d();i++) a.at1d(i) = i*0.5-3;
+    intarray b(1000);
+    for(int i=0;i<b.length1d();i++) b.at1d(i) = i*i;
+    bytearray empty;
+
+    // aligned format, read back with stdio
+    {
+        stdio stream(file,"wb");
+        fputc('x',stream);
+        narray_write_aligned(stream,a);
+        narray_write_aligned(stream,b);
+        narray_write_aligned(stream,empty);
+    }
+    {
+        stdio stream(file,"rb");
+        fgetc(stream);
+        floatarray a2;
+        intarray b2;
+        bytearray e2;
+        narray_read_aligned(stream,a2);
+        narray_read_aligned(stream,b2);
+        narray_read_aligned(stream,e2);
+        TEST_ASSERT(a2.equal(a));
+        TEST_ASSERT(b2.equal(b));
+        TEST_ASSERT(e2.length1d()==0);
+    }
+
+    // aligned format, memory mapped
+    {
+        MappedArray<float> ma(file,1);
+        TEST_ASSERT(((long)&ma->at1d(0))%narray_alignment==0);
+        TEST_ASSERT(ma->rank()==2 && ma->dim(0)==37 && ma->dim(1)==11);
+        TEST_ASSERT(ma.ref().equal(a));
+        MappedArray<int> mb(file,ma.next_offset());
+        mb.prefetch();
+        TEST_ASSERT(mb.ref().equal(b));
+        TEST_ASSERT(max(mb.ref())==999*999);
+        MappedArray<unsigned char> me(file,mb.next_offset());
+        TEST_ASSERT(me->length1d()==0);
+        TEST_FAILURE(MappedArray<double> md(file,1));
+    }
+
+    // container format, raw and compressed, with ragged arrays
+    narray<floatarray> ragged(5);
+    for(int i=0;i<ragged.length();i++) {
+        ragged(i).resize(i*100+1);
+        for(int j=0;j<ragged(i).length();j++) ragged(i)(j) = i-j;
+    }
+    doublearray big(3*container_block/sizeof (double)+17);
+    for(int i=0;i<big.length();i++) big(i) = i%1000;
+    {
+        stdio stream(file,"wb");
+        narray_save(stream,a);
+        narray_save(stream,b,container_zlib);
+        narray_save(stream,big,container_zlib,1);
+        narray_save(stream,ragged,container_zlib);
+        narray_save(stream,empty);
+        narray_save(stream,ragged);
+    }
+    {
+        stdio stream(file,"rb");
+        floatarray a2;
+        intarray b2;
+        doublearray big2;
+        narray<floatarray> ragged2;
+        bytearray e2;
+        narray_read(stream,a2);
+        narray_load(stream,b2);
+        narray_load(stream,big2);
+        narray_read(stream,ragged2);
+        narray_load(stream,e2);
+        TEST_ASSERT(a2.equal(a));
+        TEST_ASSERT(b2.equal(b));
+        TEST_ASSERT(big2.equal(big));
+        TEST_ASSERT(e2.length1d()==0);
+        TEST_ASSERT(ragged2.length()==ragged.length());
+        for(int i=0;i<ragged.length();i++)
+            TEST_ASSERT(ragged2(i).equal(ragged(i)));
+        floatarray element;
+        narray_load_element(stream,element,3);
+        TEST_ASSERT(element.equal(ragged(3)));
+        TEST_ASSERT(fgetc(stream)==EOF);
+    }
+    {
+        // corrupt a data byte and check that loading fails
+        stdio stream(file,"r+b");
+        fseek(stream,sizeof (container_header)+4,SEEK_SET);
+        fputc(0x55,stream);
+    }
+    {
+        stdio stream(file,"rb");
+        floatarray a2;
+        TEST_FAILURE(narray_load(stream,a2));
+    }
+
+    remove(file);
+    return 0;
+}
@@ -115,9 +115,8 @@ void fun_autoref(){
   TEST_OR_DIE(spf3.operator->() != 0);
   TEST_OR_DIE(spf3->get_m() == 243);
   
-#if 0
-  // no idea what this is supposed to test
-  // autorefs can't be returned
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+  // autorefs can only be returned with move constructors
   autoref<X> spf4;
   spf4=return_fun<X>();
   TEST_OR_DIE(spf4.operator->() != 0);
@@ -56,5 +56,19 @@ int main(int argc,char **argv) {
 	obj1 = (char*)strobj2;
 	TEST_ASSERT( strcmp( (char*)obj1, "Hello WorldHello World") == 0 );
 
+	// copies are deep
+	{
+		strbuf copied(strobj2);
+		copied += "!";
+		TEST_ASSERT(strobj2.length() == 22);
+		TEST_ASSERT(copied.length() == 23);
+	}
+
+	// growing an narray of strbufs hands over the buffers
+	narray<strbuf> strings;
+	for(int i=0;i<100;i++) strings.push().format("%d",i);
+	TEST_ASSERT(strcmp(strings(0),"0") == 0);
+	TEST_ASSERT(strcmp(strings(99),"99") == 0);
+
 	return 0;
 }
@@ -36,16 +36,11 @@ using namespace colib;
 
 namespace iulib {
 
-    /// Perform 1D Gaussian convolutions using a FIR filter.
-    ///
-    /// The mask is computed to 3 sigma.
+    /// Compute a normalized Gaussian mask to 3 sigma; returns the range.
 
-    template<class T>
-    void gauss1d(narray<T> &out, narray<T> &in, float sigma) {
-        out.resize(in.dim(0));
-        // make a normalized mask
+    static int gauss_mask(floatarray &mask, float sigma) {
         int range = 1+int(3.0*sigma);
-        floatarray mask(2*range+1);
+        mask.resize(2*range+1);
         for (int i=0; i<=range; i++) {
             double y = exp(-i*i/2.0/sigma/sigma);
             mask(range+i) = mask(range-i) = y;
@@ -55,8 +50,13 @@ namespace iulib {
             total += mask(i);
         for (int i=0; i<mask.dim(0); i++)
             mask(i) /= total;
+        return range;
+    }
 
-        // apply it
+    template<class T>
+    static void gauss1d_mask(narray<T> &out, narray<T> &in, floatarray &mask) {
+        int range = mask.dim(0)/2;
+        out.resize(in.dim(0));
         int n = in.length();
         for (int i=0; i<n; i++) {
             double total = 0.0;
@@ -72,18 +72,53 @@ namespace iulib {
         }
     }
 
+    /// Perform 1D Gaussian convolutions using a FIR filter.
+    ///
+    /// The mask is computed to 3 sigma.
+
+    template<class T>
+    void gauss1d(narray<T> &out, narray<T> &in, float sigma) {
+        floatarray mask;
+        gauss_mask(mask, sigma);
+        gauss1d_mask(out, in, mask);
+    }
+
 template     void gauss1d(bytearray &out, bytearray &in, float sigma);
 template     void gauss1d(floatarray &out, floatarray &in, float sigma);
 
     /// Perform 1D Gaussian convolutions using a FIR filter.
     ///
-    /// The mask is computed to 3 sigma.
+    /// The mask is computed to 3 sigma.  The convolution is done in
+    /// place; only a window of mask size of the original values is
+    /// kept, instead of a full temporary copy of the input.
 
     template<class T>
     void gauss1d(narray<T> &v, float sigma) {
-        narray<T> temp;
-        gauss1d(temp, v, sigma);
-        move(v, temp);
+        int n = v.length();
+        if (n==0)
+            return;
+        floatarray mask;
+        int range = gauss_mask(mask, sigma);
+        int m = mask.dim(0);
+        // window(k) holds the original value at position i-range+k,
+        // rotated by start
+        narray<T> window(m);
+        for (int k=0; k<m; k++)
+            window(k) = v(max(0, min(n-1, k-range)));
+        int start = 0;
+        for (int i=0; i<n; i++) {
+            double total = 0.0;
+            for (int j=0; j<m; j++) {
+                int k = start+j;
+                if (k>=m)
+                    k -= m;
+                total += window(k) * mask(j);
+            }
+            // positions to the right of i haven't been overwritten yet
+            window(start) = v(min(n-1, i+1+range));
+            start = (start+1==m) ? 0 : start+1;
+            v(i) = T(total);
+        }
     }
 
 template         void gauss1d(bytearray &v, float sigma);
@@ -95,15 +130,17 @@ template         void gauss1d(floatarray &v, float sigma);
 
     template<class T>
     void gauss2d(narray<T> &a, float sx, float sy) {
-        floatarray r, s;
+        floatarray r, s, mask;
+        gauss_mask(mask, sy);
         for (int i=0; i<a.dim(0); i++) {
             getd0(a, r, i);
-            gauss1d(s, r, sy);
+            gauss1d_mask(s, r, mask);
             putd0(a, s, i);
         }
+        gauss_mask(mask, sx);
         for (int j=0; j<a.dim(1); j++) {
             getd1(a, r, j);
-            gauss1d(s, r, sx);
+            gauss1d_mask(s, r, mask);
             putd1(a, s, j);
         }
     }
@@ -34,6 +34,21 @@ namespace iulib {
     template<class T> void gauss1d(colib::narray<T> &v, float sigma);
     template<class T> void gauss2d(colib::narray<T> &a, float sx, float sy);
 
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+    // Filter a temporary in place and hand it back, without copying.
+
+    template<class T>
+    inline colib::narray<T> gauss1d(colib::narray<T> &&v, float sigma) {
+        gauss1d(v, sigma);
+        return colib::narray<T>(v.rvalue());
+    }
+    template<class T>
+    inline colib::narray<T> gauss2d(colib::narray<T> &&a, float sx, float sy) {
+        gauss2d(a, sx, sy);
+        return colib::narray<T>(a.rvalue());
+    }
+#endif
+
 }
 
 #endif
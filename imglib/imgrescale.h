@@ -36,6 +36,29 @@ namespace iulib {
     void rescale_to_width(colib::bytearray &dst, const colib::bytearray &src, int w);
     void rescale_to_height(colib::floatarray &dst, const colib::floatarray &src, int h);
     void rescale_to_height(colib::bytearray &dst, const colib::bytearray &src, int h);
+
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+    // Value-returning versions; the result is moved out, not copied.
+
+    template <class T>
+    inline colib::narray<T> rescale(const colib::narray<T> &src, int w, int h) {
+        colib::narray<T> dst;
+        rescale(dst, src, w, h);
+        return dst;
+    }
+    template <class T>
+    inline colib::narray<T> rescale_to_width(const colib::narray<T> &src, int w) {
+        colib::narray<T> dst;
+        rescale_to_width(dst, src, w);
+        return dst;
+    }
+    template <class T>
+    inline colib::narray<T> rescale_to_height(const colib::narray<T> &src, int h) {
+        colib::narray<T> dst;
+        rescale_to_height(dst, src, h);
+        return dst;
+    }
+#endif
 }
 
 #endif
@@ -134,6 +134,20 @@ int main(int argc,char **argv) {
   }
 #endif
   GaussianConvProperty(in, variance, mean);
+
+  // in-place filtering gives the same result as filtering into a new array
+  floatarray v(100);
+  for (int i=0; i<v.dim(0); i++)
+    v(i) = (i*37)%11;
+  floatarray v2;
+  gauss1d(v2, v, 2.5);
+  gauss1d(v, 2.5);
+  TEST_ASSERT(v.equal(v2));
+  floatarray w(3);
+  w(0) = 1; w(1) = 5; w(2) = 2;
+  gauss1d(v2, w, 3.0);
+  gauss1d(w, 3.0);
+  TEST_ASSERT(w.equal(v2));
 }
 
 